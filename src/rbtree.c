@@ -1,14 +1,50 @@
 #include "rbtree.h"
 #include <stdlib.h>
 
+// 기본 할당자: malloc / free
+static void *default_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return malloc(size);
+}
+
+static void default_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+static const rbtree_allocator default_allocator = {default_alloc, default_free, NULL};
+
 // 트리 초기화
 rbtree *new_rbtree(void) {
-  rbtree *t = (rbtree *)calloc(1, sizeof(rbtree));			  
-  node_t *nil_node = (node_t *)calloc(1, sizeof(node_t));	
-  nil_node->color = RBTREE_BLACK;							            
-  t->nil = nil_node;										                  
-  t->root = nil_node;										                  
-  return t;													                     
+  return new_rbtree_with(NULL, 0);
+}
+
+// 할당자와 노드 개수 상한(0이면 무제한)을 지정하여 트리 초기화
+// 할당에 실패하면 NULL 반환
+rbtree *new_rbtree_with(const rbtree_allocator *allocator, const size_t max_nodes) {
+  if (allocator == NULL) {                                    // 할당자가 없으면 malloc / free 사용
+    allocator = &default_allocator;
+  }
+  rbtree *t = (rbtree *)allocator->alloc(allocator->ctx, sizeof(rbtree));
+  if (t == NULL) {
+    return NULL;
+  }
+  node_t *nil_node = (node_t *)allocator->alloc(allocator->ctx, sizeof(node_t));
+  if (nil_node == NULL) {                                     // nil 할당 실패 시 트리도 반환
+    allocator->free(allocator->ctx, t, sizeof(rbtree));
+    return NULL;
+  }
+  nil_node->color = RBTREE_BLACK;
+  nil_node->key = 0;
+  nil_node->parent = nil_node->left = nil_node->right = NULL;
+  t->nil = nil_node;
+  t->root = nil_node;
+  t->allocator = *allocator;
+  t->node_count = 0;
+  t->cache = NULL;
+  t->max_nodes = max_nodes;
+  return t;
 }
 
 // 각각의 노드들이 가리키는 공간들 해제
@@ -20,8 +56,7 @@ void delete_node(node_t *node, rbtree *t) {
 
   delete_node(node->left, t);   // 왼쪽으로 재귀
   delete_node(node->right, t);  // 오른쪽으로 재귀
-  free(node);                   // 현재 노드가 가리키는 메모리 할당 해제
-  node = NULL;                  // 할당 해제 후 현재 노드값을 NULL로 초기화
+  t->allocator.free(t->allocator.ctx, node, sizeof(node_t));  // 현재 노드가 가리키는 메모리 할당 해제
   return;
 }
 
@@ -32,11 +67,11 @@ void delete_rbtree(rbtree *t) {
     return;
   }
 
-  delete_node(t->root, t);  // 생성된 노드들이 가리키는 메모리 해제
-  free(t->nil);             // 트리의 nil노드가 가리키는 메모리 해제
-  t->nil = NULL;            // 메모리 해제 후 트리의 nil노드값을 NULL로 초기화
-  free(t);                  // 트리가 가리키는 메모리 할당 해제
-  t = NULL;                 // 메모리 해제 후 트리의 값을 NULL로 초기화
+  rbtree_allocator allocator = t->allocator;          // 트리 해제 후에도 쓸 수 있도록 복사
+  rbtree_disable_cache(t);                            // 캐시가 있으면 해제
+  delete_node(t->root, t);                            // 생성된 노드들이 가리키는 메모리 해제
+  allocator.free(allocator.ctx, t->nil, sizeof(node_t));  // 트리의 nil노드가 가리키는 메모리 해제
+  allocator.free(allocator.ctx, t, sizeof(rbtree));       // 트리가 가리키는 메모리 할당 해제
   return;
 }
 
@@ -123,7 +158,16 @@ void rbtree_insert_fixup(rbtree *t, node_t *z) {
 }
 
 // 삽입
-node_t *rbtree_insert(rbtree *t, const key_t key) {
+// 성공 시 RBTREE_OK를 반환하고 *out에 새 노드를 넘겨준다
+// 노드 개수 상한에 걸리면 RBTREE_EQUOTA, 할당에 실패하면 RBTREE_ENOMEM을 반환하며 트리는 변하지 않는다
+int rbtree_insert_node(rbtree *t, const key_t key, node_t **out) {
+  if (t->max_nodes != 0 && t->node_count >= t->max_nodes) {  // 상한 초과
+    return RBTREE_EQUOTA;
+  }
+  node_t* z = (node_t *)t->allocator.alloc(t->allocator.ctx, sizeof(node_t));  // z(노드) 생성
+  if (z == NULL) {            // 할당 실패
+    return RBTREE_ENOMEM;
+  }
   node_t* y = t->nil;     // y는 트리의 nil노드
   node_t* x = t->root;    // x는 트리의 root노드
   while (x != t->nil) {   // 서브트리 탐색
@@ -134,7 +178,6 @@ node_t *rbtree_insert(rbtree *t, const key_t key) {
       x = x->right;
     }
   }
-  node_t* z = (node_t *)calloc(1, sizeof(node_t));  // z(노드) 생성
   z->parent = y;              // z의 부모 = y
   if (y == t->nil) {          // y가 트리의 nil일 때(첫 노드 삽입)
     t->root = z;              // 트리의 root = z
@@ -148,11 +191,28 @@ node_t *rbtree_insert(rbtree *t, const key_t key) {
   z->left = t->nil;           // 좌 / 우 자식 NIL 연결
   z->right = t->nil;           
   rbtree_insert_fixup(t, z);  // fixup 호출
-  return t->root;             // 트리의 root값 반환
+  t->node_count++;
+  if (out != NULL) {
+    *out = z;
+  }
+  return RBTREE_OK;
 }
 
-// 트리에서 원하는 값 찾기
-node_t *rbtree_find(const rbtree *t, const key_t key) {
+// 삽입 후 트리의 root값 반환, 실패하면 NULL 반환
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  if (rbtree_insert_node(t, key, NULL) != RBTREE_OK) {
+    return NULL;
+  }
+  return t->root;
+}
+
+// key가 들어갈 캐시 슬롯 (Fibonacci hashing, 상위 비트 사용)
+static node_t **cache_slot(const rbtree_cache *c, const key_t key) {
+  return &c->slots[((unsigned int)key * 2654435769u) >> c->shift];
+}
+
+// 캐시 없이 트리를 따라 내려가며 key 탐색
+static node_t *rbtree_find_walk(const rbtree *t, const key_t key) {
   node_t *x = t->root;                    // x는 트리의 루트
   while (x != t->nil && key != x->key) {  // 서브트리 탐색
     if (x->key < key) {
@@ -166,6 +226,79 @@ node_t *rbtree_find(const rbtree *t, const key_t key) {
   }
   return x;                               // x가 nil노드가 아니면 x 반환, 즉 key를 찾았을 때
 }
+
+// 트리에서 원하는 값 찾기
+// 캐시가 켜져 있으면 슬롯을 먼저 확인하고, 못 찾으면 트리를 탐색한 뒤 슬롯을 채운다
+// 캐시 갱신 때문에 캐시가 켜진 트리에서는 동시에 여러 스레드가 find를 호출하면 안 된다
+node_t *rbtree_find(const rbtree *t, const key_t key) {
+  rbtree_cache *c = t->cache;
+  if (c == NULL) {
+    return rbtree_find_walk(t, key);
+  }
+  node_t **slot = cache_slot(c, key);
+  if (*slot != NULL && (*slot)->key == key) {  // 적중, multiset이므로 같은 key의 아무 노드나 반환해도 된다
+    c->hits++;
+    return *slot;
+  }
+  c->misses++;
+  node_t *x = rbtree_find_walk(t, key);
+  if (x != NULL) {                        // 찾은 노드만 캐시, 없는 key는 캐시하지 않음
+    *slot = x;
+  }
+  return x;
+}
+
+// 슬롯 slots개(2 이상의 2의 거듭제곱으로 올림)짜리 캐시 생성, 이미 있으면 새로 만든다
+// 할당에 실패하면 RBTREE_ENOMEM 반환
+int rbtree_enable_cache(rbtree *t, const size_t slots) {
+  size_t size = 2;
+  unsigned int bits = 1;
+  while (size < slots && bits < 31) {     // 해시가 32비트이므로 최대 2^31 슬롯
+    size <<= 1;
+    bits++;
+  }
+  rbtree_cache *c = (rbtree_cache *)t->allocator.alloc(t->allocator.ctx, sizeof(rbtree_cache));
+  if (c == NULL) {
+    return RBTREE_ENOMEM;
+  }
+  c->slots = (node_t **)t->allocator.alloc(t->allocator.ctx, size * sizeof(node_t *));
+  if (c->slots == NULL) {
+    t->allocator.free(t->allocator.ctx, c, sizeof(rbtree_cache));
+    return RBTREE_ENOMEM;
+  }
+  for (size_t i = 0; i < size; i++) {
+    c->slots[i] = NULL;
+  }
+  c->size = size;
+  c->shift = 32 - bits;
+  c->hits = 0;
+  c->misses = 0;
+  rbtree_disable_cache(t);
+  t->cache = c;
+  return RBTREE_OK;
+}
+
+// 캐시 해제
+void rbtree_disable_cache(rbtree *t) {
+  rbtree_cache *c = t->cache;
+  if (c == NULL) {
+    return;
+  }
+  t->allocator.free(t->allocator.ctx, c->slots, c->size * sizeof(node_t *));
+  t->allocator.free(t->allocator.ctx, c, sizeof(rbtree_cache));
+  t->cache = NULL;
+}
+
+// 캐시 적중 / 실패 횟수, 캐시가 꺼져 있으면 0
+void rbtree_cache_stats(const rbtree *t, size_t *hits, size_t *misses) {
+  if (hits != NULL) {
+    *hits = (t->cache != NULL) ? t->cache->hits : 0;
+  }
+  if (misses != NULL) {
+    *misses = (t->cache != NULL) ? t->cache->misses : 0;
+  }
+}
+
 // 트리의 최솟값
 node_t *rbtree_min(const rbtree *t) {
   node_t *x = t->root;        // 트리에서 가장 작은 값은 트리의 가장 왼쪽에 위치한다
@@ -289,8 +422,14 @@ int rbtree_erase(rbtree *t, node_t *p) {
     y->left->parent = y;                  // y의 왼쪽 자식의 부모 = y
     y->color = p->color;                  // y의 색 = 삭제할 노드의 색
   }
-  free(p);                                // 삭제한 노드가 가리키는 공간 삭제
-  p = NULL;                               // 할당 해제 후 삭제한 노드값을 NULL로 초기화
+  if (t->cache != NULL) {                 // 삭제한 노드를 가리키는 캐시 슬롯 무효화
+    node_t **slot = cache_slot(t->cache, p->key);
+    if (*slot == p) {
+      *slot = NULL;
+    }
+  }
+  t->allocator.free(t->allocator.ctx, p, sizeof(node_t));  // 삭제한 노드가 가리키는 공간 삭제
+  t->node_count--;
   if (y_color == RBTREE_BLACK) {          // y_color가 BLACK이면(삭제한 노드의 색이 BLACK이면(특성 5 위반))
     rb_delete_fixup(t, x);                // fixup 호출
   }
@@ -322,4 +461,174 @@ int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
   }
   rbtree_inorder(t->nil, t->root, arr, n, 0); // 중위 순회
   return 0;
-}
\ No newline at end of file
+}
+
+// 검증용 명시적 스택의 깊이, 높이는 2*log2(n+1)을 넘지 않으므로 64비트 주소 공간에서 충분하다
+#define RBTREE_VALIDATE_DEPTH 128
+
+static rbtree_violation validate_fail(rbtree_report *r, const rbtree_violation v, const node_t *node) {
+  r->violation = v;
+  r->node = node;
+  return v;
+}
+
+// 노드 x 자신과 자식 연결에 대한 지역 검사(부모 포인터, red-red)
+static rbtree_violation validate_local(const rbtree *t, const node_t *x, rbtree_report *r) {
+  if (x->left != t->nil && x->left->parent != x) {
+    return validate_fail(r, RBTREE_ERR_PARENT, x->left);
+  }
+  if (x->right != t->nil && x->right->parent != x) {
+    return validate_fail(r, RBTREE_ERR_PARENT, x->right);
+  }
+  if (x->color == RBTREE_RED &&
+      (x->left->color == RBTREE_RED || x->right->color == RBTREE_RED)) {
+    return validate_fail(r, RBTREE_ERR_RED_RED, x);
+  }
+  return RBTREE_VALID;
+}
+
+// 트리 전체 검증
+// 재귀 없이 명시적 스택으로 중위 순회하며 BST 순서, 부모 포인터, red-red, black height를 한 번에 검사
+// 위반이 있으면 그 종류를 반환하고 report->node에 위반한 노드를 넘겨준다
+rbtree_violation rbtree_validate(const rbtree *t, rbtree_report *report) {
+  rbtree_report dummy;
+  rbtree_report *r = (report != NULL) ? report : &dummy;
+  r->violation = RBTREE_VALID;
+  r->node = NULL;
+  r->visited = 0;
+  r->black_height = -1;
+
+  if (t->nil->color != RBTREE_BLACK) {
+    return validate_fail(r, RBTREE_ERR_NIL_COLOR, t->nil);
+  }
+  if (t->root == t->nil) {
+    r->black_height = 0;
+    return t->node_count == 0 ? RBTREE_VALID : validate_fail(r, RBTREE_ERR_COUNT, NULL);
+  }
+  if (t->root->color != RBTREE_BLACK) {
+    return validate_fail(r, RBTREE_ERR_ROOT_COLOR, t->root);
+  }
+  if (t->root->parent != t->nil) {
+    return validate_fail(r, RBTREE_ERR_PARENT, t->root);
+  }
+
+  const node_t *stack[RBTREE_VALIDATE_DEPTH];
+  int black[RBTREE_VALIDATE_DEPTH];    // 스택의 각 노드까지(자신 포함) 검정 노드 수
+  int level[RBTREE_VALIDATE_DEPTH];    // 스택의 각 노드까지(자신 포함) 경로 길이
+  int top = 0;
+  const node_t *prev = NULL;           // 중위 순회에서 직전 노드
+  const node_t *x = t->root;
+  int depth = 0;                       // x 위쪽의 검정 노드 수
+  int height = 0;                      // x 위쪽의 노드 수, 스택 크기는 항상 이 값 이하
+  rbtree_violation v;
+
+  for (;;) {
+    while (x != t->nil) {              // 왼쪽 끝까지 내려가며 지역 검사
+      if (++height > RBTREE_VALIDATE_DEPTH) {  // 오른쪽으로 내려간 경로도 포함한 실제 높이
+        return validate_fail(r, RBTREE_ERR_HEIGHT, x);
+      }
+      if ((v = validate_local(t, x, r)) != RBTREE_VALID) {
+        return v;
+      }
+      depth += (x->color == RBTREE_BLACK) ? 1 : 0;
+      if (x->left == t->nil || x->right == t->nil) {  // x 아래에서 끝나는 경로가 있음
+        if (r->black_height < 0) {
+          r->black_height = depth;
+        } else if (depth != r->black_height) {
+          return validate_fail(r, RBTREE_ERR_BLACK_HEIGHT, x);
+        }
+      }
+      stack[top] = x;
+      black[top] = depth;
+      level[top] = height;
+      top++;
+      x = x->left;
+    }
+    if (top == 0) {
+      break;
+    }
+    top--;
+    x = stack[top];
+    depth = black[top];
+    height = level[top];
+    if (prev != NULL && x->key < prev->key) {       // 중위 순회 결과는 오름차순이어야 함
+      return validate_fail(r, RBTREE_ERR_ORDER, x);
+    }
+    prev = x;
+    r->visited++;
+    x = x->right;
+  }
+
+  if (r->visited != t->node_count) {
+    return validate_fail(r, RBTREE_ERR_COUNT, NULL);
+  }
+  return RBTREE_VALID;
+}
+
+// 표본 검증
+// root에서 leaf까지 무작위 경로 paths개를 따라가며 검사, 경로 하나당 O(log n)
+// 경로 위의 노드에 대해 부모 포인터, red-red, 조상 키로 정해지는 범위, black height를 검사한다
+// seed는 rand_r처럼 호출자가 가지고 있어 여러 트리를 동시에 검증할 수 있다
+rbtree_violation rbtree_validate_sampled(const rbtree *t, const size_t paths,
+                                         unsigned int *seed, rbtree_report *report) {
+  rbtree_report dummy;
+  rbtree_report *r = (report != NULL) ? report : &dummy;
+  r->violation = RBTREE_VALID;
+  r->node = NULL;
+  r->visited = 0;
+  r->black_height = -1;
+
+  if (t->nil->color != RBTREE_BLACK) {
+    return validate_fail(r, RBTREE_ERR_NIL_COLOR, t->nil);
+  }
+  if (t->root == t->nil) {
+    r->black_height = 0;
+    return RBTREE_VALID;
+  }
+  if (t->root->color != RBTREE_BLACK) {
+    return validate_fail(r, RBTREE_ERR_ROOT_COLOR, t->root);
+  }
+  if (t->root->parent != t->nil) {
+    return validate_fail(r, RBTREE_ERR_PARENT, t->root);
+  }
+
+  rbtree_violation v;
+  for (size_t i = 0; i < paths; i++) {
+    const node_t *lo = NULL, *hi = NULL;   // 경로상 조상이 정하는 키의 하한 / 상한
+    const node_t *x = t->root;
+    int depth = 0, height = 0;
+    while (x != t->nil) {
+      if (++height > RBTREE_VALIDATE_DEPTH) {
+        return validate_fail(r, RBTREE_ERR_HEIGHT, x);
+      }
+      if ((v = validate_local(t, x, r)) != RBTREE_VALID) {
+        return v;
+      }
+      if ((lo != NULL && x->key < lo->key) || (hi != NULL && x->key > hi->key)) {
+        return validate_fail(r, RBTREE_ERR_ORDER, x);
+      }
+      depth += (x->color == RBTREE_BLACK) ? 1 : 0;
+      r->visited++;
+      *seed = *seed * 1103515245u + 12345u;  // LCG, 상위 비트 사용
+      if (*seed & 0x40000000u) {
+        if (x->left == t->nil) {
+          break;
+        }
+        hi = x;
+        x = x->left;
+      } else {
+        if (x->right == t->nil) {
+          break;
+        }
+        lo = x;
+        x = x->right;
+      }
+    }
+    if (r->black_height < 0) {
+      r->black_height = depth;
+    } else if (depth != r->black_height) {
+      return validate_fail(r, RBTREE_ERR_BLACK_HEIGHT, x);
+    }
+  }
+  return RBTREE_VALID;
+}
@@ -13,15 +13,39 @@ typedef struct node_t {
   struct node_t *parent, *left, *right;
 } node_t;
 
+// error codes returned by rbtree_insert_node
+enum { RBTREE_OK = 0, RBTREE_ENOMEM = -1, RBTREE_EQUOTA = -2 };
+
+// user supplied allocator (pool, arena, NUMA-local region, ...)
+typedef struct {
+  void *(*alloc)(void *ctx, size_t size);
+  void (*free)(void *ctx, void *ptr, size_t size);
+  void *ctx;
+} rbtree_allocator;
+
+// direct-mapped key -> node cache in front of rbtree_find
+typedef struct {
+  node_t **slots;
+  size_t size;  // number of slots, power of two
+  unsigned shift;
+  size_t hits, misses;
+} rbtree_cache;
+
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  rbtree_allocator allocator;
+  size_t node_count;
+  size_t max_nodes;  // 0 for unlimited
+  rbtree_cache *cache;  // NULL when disabled
 } rbtree;
 
 rbtree *new_rbtree(void);
+rbtree *new_rbtree_with(const rbtree_allocator *, const size_t max_nodes);
 void delete_rbtree(rbtree *);
 
 node_t *rbtree_insert(rbtree *, const key_t);
+int rbtree_insert_node(rbtree *, const key_t, node_t **);
 node_t *rbtree_find(const rbtree *, const key_t);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
@@ -29,4 +53,32 @@ int rbtree_erase(rbtree *, node_t *);
 
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
 
+int rbtree_enable_cache(rbtree *, const size_t slots);
+void rbtree_disable_cache(rbtree *);
+void rbtree_cache_stats(const rbtree *, size_t *hits, size_t *misses);
+
+// invariant violations reported by rbtree_validate
+typedef enum {
+  RBTREE_VALID = 0,
+  RBTREE_ERR_NIL_COLOR,     // sentinel is not black
+  RBTREE_ERR_ROOT_COLOR,    // root is not black
+  RBTREE_ERR_PARENT,        // child->parent does not point back
+  RBTREE_ERR_ORDER,         // key out of search order
+  RBTREE_ERR_RED_RED,       // red node with a red child
+  RBTREE_ERR_BLACK_HEIGHT,  // paths with different black counts
+  RBTREE_ERR_HEIGHT,        // root-to-leaf path longer than 128 nodes
+  RBTREE_ERR_COUNT          // node count does not match node_count
+} rbtree_violation;
+
+typedef struct {
+  rbtree_violation violation;
+  const node_t *node;  // offending node, NULL if not node specific
+  size_t visited;      // nodes visited
+  int black_height;    // black nodes on a root-to-leaf path
+} rbtree_report;
+
+rbtree_violation rbtree_validate(const rbtree *, rbtree_report *);
+rbtree_violation rbtree_validate_sampled(const rbtree *, const size_t paths,
+                                         unsigned int *seed, rbtree_report *);
+
 #endif  // _RBTREE_H_
@@ -0,0 +1,130 @@
+#include <assert.h>
+#include <math.h>
+#include <rbtree.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Zipf lookup benchmark
+// Compares rbtree_find with and without the hot-key cache on a heavy-tailed
+// lookup stream.
+//
+// Plain and cached passes alternate for ROUNDS rounds and the best time of
+// each is reported, so warm-up and frequency scaling do not favour either.
+//
+// ./bench-rbtree [keys] [lookups] [cache_slots] [zipf_s]
+
+#define ROUNDS 3
+
+static uint64_t xorshift64(uint64_t *s) {
+  uint64_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *s = x;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// lookups[i] = keys[rank] where rank follows Zipf(s) over the key ranks
+static void zipf_lookups(const key_t *keys, const size_t n, key_t *lookups,
+                         const size_t m, const double s, uint64_t *seed) {
+  double *cdf = malloc(n * sizeof(double));
+  assert(cdf != NULL);
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += 1.0 / pow((double)(i + 1), s);
+    cdf[i] = sum;
+  }
+  for (size_t j = 0; j < m; j++) {
+    double u = (xorshift64(seed) >> 11) * (1.0 / 9007199254740992.0) * sum;
+    size_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < u) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    lookups[j] = keys[lo];
+  }
+  free(cdf);
+}
+
+static double run(const rbtree *t, const key_t *lookups, const size_t m,
+                  size_t *found) {
+  size_t f = 0;
+  double start = now();
+  for (size_t j = 0; j < m; j++) {
+    f += rbtree_find(t, lookups[j]) != NULL;
+  }
+  double elapsed = now() - start;
+  *found = f;
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  size_t m = argc > 2 ? strtoull(argv[2], NULL, 10) : 20000000;
+  size_t slots = argc > 3 ? strtoull(argv[3], NULL, 10) : 65536;
+  double s = argc > 4 ? atof(argv[4]) : 1.0;
+  uint64_t seed = 17;
+
+  // random distinct-ish keys, so hot ranks are scattered across the tree
+  key_t *keys = malloc(n * sizeof(key_t));
+  key_t *lookups = malloc(m * sizeof(key_t));
+  assert(keys != NULL && lookups != NULL);
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = (key_t)(xorshift64(&seed) >> 33);
+    rbtree_insert(t, keys[i]);
+  }
+  zipf_lookups(keys, n, lookups, m, s, &seed);
+
+  size_t found, hits = 0, misses = 0, cache_size = 0;
+  double plain = 0, cached = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    rbtree_disable_cache(t);
+    double elapsed = run(t, lookups, m, &found);
+    if (found != m) {
+      abort();
+    }
+    if (round == 0 || elapsed < plain) {
+      plain = elapsed;
+    }
+
+    // a fresh cache every round, so each cached pass starts cold
+    if (rbtree_enable_cache(t, slots) != RBTREE_OK) {
+      fprintf(stderr, "rbtree_enable_cache: out of memory\n");
+      return 1;
+    }
+    elapsed = run(t, lookups, m, &found);
+    if (found != m) {
+      abort();
+    }
+    if (round == 0 || elapsed < cached) {
+      cached = elapsed;
+    }
+    rbtree_cache_stats(t, &hits, &misses);
+    cache_size = t->cache->size;
+  }
+
+  printf("keys %zu, lookups %zu, zipf s=%.2f, cache slots %zu, best of %d\n",
+         n, m, s, cache_size, ROUNDS);
+  printf("plain  find: %8.3f s  %6.1f ns/op\n", plain, plain * 1e9 / m);
+  printf("cached find: %8.3f s  %6.1f ns/op  (hit rate %.1f%%)\n", cached,
+         cached * 1e9 / m, 100.0 * hits / (hits + misses));
+  printf("speedup: %.2fx\n", plain / cached);
+
+  delete_rbtree(t);
+  free(lookups);
+  free(keys);
+  return 0;
+}
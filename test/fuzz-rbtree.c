@@ -0,0 +1,419 @@
+#include <assert.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Differential stress test
+// Runs mixed insert/erase/find/min/max/to_array sequences against a sorted
+// array model and runs rbtree_validate every `check_every` operations.
+// The sorted array keeps min/max/to_array checks exact but costs O(n) per
+// update, so that phase is capped at MODEL_CAP nodes. A second phase grows a
+// tree to `large_nodes` nodes against a key -> count model.
+//
+// Standalone:  ./fuzz-rbtree [ops] [seed] [check_every] [large_nodes]
+// libFuzzer:   build with -DRBTREE_LIBFUZZER -fsanitize=fuzzer (make libfuzzer)
+
+#define MODEL_CAP 4096  // node budget of the tree and capacity of the model
+#define QUARANTINE 1024  // freed blocks kept poisoned before really freeing
+#define POISON 0xa5
+
+enum { OP_INSERT, OP_ERASE, OP_FIND, OP_MINMAX, OP_TO_ARRAY, OP_COUNT };
+
+typedef struct {
+  rbtree *t;
+  key_t keys[MODEL_CAP];  // sorted, duplicates allowed
+  size_t n;
+  key_t buf[MODEL_CAP];   // scratch space for to_array
+  size_t check_every;
+  size_t ops;
+  void *quarantine[QUARANTINE];  // ring of recently freed blocks
+  size_t quarantine_next;
+} harness;
+
+#define CHECK(cond)                                                  \
+  do {                                                               \
+    if (!(cond)) {                                                   \
+      fprintf(stderr, "%s:%d: check failed after %zu ops: %s\n",     \
+              __FILE__, __LINE__, h->ops, #cond);                    \
+      abort();                                                       \
+    }                                                                \
+  } while (0)
+
+// first index i such that keys[i] >= key
+static size_t lower_bound(const harness *h, const key_t key) {
+  size_t lo = 0, hi = h->n;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (h->keys[mid] < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static bool model_contains(const harness *h, const key_t key) {
+  size_t i = lower_bound(h, key);
+  return i < h->n && h->keys[i] == key;
+}
+
+// Allocator that poisons freed blocks and keeps them alive for a while, so a
+// cache slot left pointing at an erased node stays readable and detectable.
+static void *quarantine_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return malloc(size);
+}
+
+static void quarantine_free(void *ctx, void *ptr, size_t size) {
+  harness *h = (harness *)ctx;
+  memset(ptr, POISON, size);
+  free(h->quarantine[h->quarantine_next]);
+  h->quarantine[h->quarantine_next] = ptr;
+  h->quarantine_next = (h->quarantine_next + 1) % QUARANTINE;
+}
+
+static void flush_quarantine(harness *h) {
+  for (size_t i = 0; i < QUARANTINE; i++) {
+    free(h->quarantine[i]);
+    h->quarantine[i] = NULL;
+  }
+}
+
+// No cache slot may point at a freed (poisoned) node.
+static void check_cache(harness *h) {
+  const rbtree_cache *c = h->t->cache;
+  for (size_t i = 0; i < c->size; i++) {
+    const node_t *p = c->slots[i];
+    CHECK(p == NULL || p->color == RBTREE_RED || p->color == RBTREE_BLACK);
+  }
+}
+
+// Full validation plus a few sampled paths, reporting the offending node.
+static void check_invariants(harness *h) {
+  rbtree_report r;
+  if (rbtree_validate(h->t, &r) != RBTREE_VALID) {
+    fprintf(stderr, "rbtree_validate: violation %d at node %p (key %d)\n",
+            r.violation, (void *)r.node, r.node ? r.node->key : 0);
+  }
+  CHECK(r.violation == RBTREE_VALID);
+  CHECK(r.visited == h->n);
+
+  unsigned int seed = (unsigned int)h->ops;
+  CHECK(rbtree_validate_sampled(h->t, 8, &seed, NULL) == RBTREE_VALID);
+  check_cache(h);
+}
+
+static void op_insert(harness *h, const key_t key) {
+  node_t *p = NULL;
+  int ret = rbtree_insert_node(h->t, key, &p);
+  if (h->n == MODEL_CAP) {
+    CHECK(ret == RBTREE_EQUOTA);
+    CHECK(p == NULL);
+    return;
+  }
+  CHECK(ret == RBTREE_OK);
+  CHECK(p != NULL && p->key == key);
+  size_t i = lower_bound(h, key);
+  memmove(&h->keys[i + 1], &h->keys[i], (h->n - i) * sizeof(key_t));
+  h->keys[i] = key;
+  h->n++;
+}
+
+static void op_erase(harness *h, const key_t key) {
+  node_t *p = rbtree_find(h->t, key);
+  size_t i = lower_bound(h, key);
+  if (i == h->n || h->keys[i] != key) {
+    CHECK(p == NULL);
+    return;
+  }
+  CHECK(p != NULL && p->key == key);
+  rbtree_erase(h->t, p);
+  check_cache(h);  // erase must have invalidated p's slot
+  memmove(&h->keys[i], &h->keys[i + 1], (h->n - i - 1) * sizeof(key_t));
+  h->n--;
+}
+
+static void op_find(harness *h, const key_t key) {
+  node_t *p = rbtree_find(h->t, key);
+  if (model_contains(h, key)) {
+    CHECK(p != NULL && p->key == key);
+  } else {
+    CHECK(p == NULL);
+  }
+}
+
+static void op_minmax(harness *h) {
+  if (h->n == 0) {
+    return;  // min/max of an empty tree is not defined
+  }
+  node_t *p = rbtree_min(h->t);
+  node_t *q = rbtree_max(h->t);
+  CHECK(p != NULL && p->key == h->keys[0]);
+  CHECK(q != NULL && q->key == h->keys[h->n - 1]);
+}
+
+static void op_to_array(harness *h, const size_t limit) {
+  size_t n = limit < h->n ? limit : h->n;
+  rbtree_to_array(h->t, h->buf, n);
+  CHECK(memcmp(h->buf, h->keys, n * sizeof(key_t)) == 0);
+}
+
+static void step(harness *h, const unsigned op, const key_t key) {
+  switch (op % OP_COUNT) {
+    case OP_INSERT:
+      op_insert(h, key);
+      break;
+    case OP_ERASE:
+      op_erase(h, key);
+      break;
+    case OP_FIND:
+      op_find(h, key);
+      break;
+    case OP_MINMAX:
+      op_minmax(h);
+      break;
+    case OP_TO_ARRAY:
+      op_to_array(h, (size_t)(uint16_t)key);
+      break;
+  }
+  h->ops++;
+  if (h->check_every != 0 && h->ops % h->check_every == 0) {
+    check_invariants(h);
+  }
+}
+
+static harness *new_harness(const size_t check_every) {
+  harness *h = calloc(1, sizeof(harness));
+  if (h == NULL) {
+    abort();
+  }
+  const rbtree_allocator a = {quarantine_alloc, quarantine_free, h};
+  h->t = new_rbtree_with(&a, MODEL_CAP);
+  CHECK(h->t != NULL);
+  // small cache so that collisions and erase invalidation are exercised
+  const int ret = rbtree_enable_cache(h->t, 64);
+  CHECK(ret == RBTREE_OK);
+  h->check_every = check_every;
+  return h;
+}
+
+static void delete_harness(harness *h) {
+  check_invariants(h);
+  delete_rbtree(h->t);
+  flush_quarantine(h);
+  free(h);
+}
+
+// Each operation consumes three bytes: opcode, then a little-endian 16 bit
+// key. The narrow key range keeps duplicates and hits frequent.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  harness *h = new_harness(1);
+  for (size_t i = 0; i + 3 <= size; i += 3) {
+    key_t key = (int16_t)(data[i + 1] | (data[i + 2] << 8));
+    step(h, data[i], key);
+  }
+  delete_harness(h);
+  return 0;
+}
+
+#ifndef RBTREE_LIBFUZZER
+
+static uint64_t xorshift64(uint64_t *s) {
+  uint64_t x = *s;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *s = x;
+}
+
+// Random driver: insert-heavy while the tree is small, erase-heavy once it
+// approaches MODEL_CAP, so the size keeps sweeping across the whole range.
+static void run_random(const size_t ops, uint64_t seed, const size_t check_every) {
+  harness *h = new_harness(check_every);
+  const uint32_t key_range = 2 * MODEL_CAP;  // about half of the keys collide
+  if (seed == 0) {
+    seed = 1;
+  }
+  bool growing = true;
+  for (size_t i = 0; i < ops; i++) {
+    uint64_t r = xorshift64(&seed);
+    key_t key = (key_t)((r >> 32) % key_range) - (key_t)(key_range / 2);
+    unsigned sel = (unsigned)(r & 0xff);
+    unsigned op;
+    if (h->n == 0) {
+      growing = true;
+    } else if (h->n == MODEL_CAP) {
+      growing = false;
+    }
+    if (sel < 100) {
+      op = growing ? OP_INSERT : OP_ERASE;
+    } else if (sel < 140) {
+      op = growing ? OP_ERASE : OP_INSERT;
+    } else if (sel < 240) {
+      op = OP_FIND;
+    } else if (sel < 255) {
+      op = OP_MINMAX;
+    } else {
+      op = OP_TO_ARRAY;
+    }
+    step(h, op, key);
+  }
+  delete_harness(h);
+}
+
+// Large phase model: occurrence count for every key in [0, range)
+typedef struct {
+  rbtree *t;
+  uint32_t *count;
+  size_t range;
+  size_t n;
+  size_t ops;
+} large_model;
+
+// Full validation, min/max and a complete to_array against the counts.
+static void large_check(large_model *h) {
+  rbtree_report r;
+  rbtree_validate(h->t, &r);
+  if (r.violation != RBTREE_VALID) {
+    fprintf(stderr, "rbtree_validate: violation %d at node %p (key %d)\n",
+            r.violation, (void *)r.node, r.node ? r.node->key : 0);
+  }
+  CHECK(r.violation == RBTREE_VALID);
+  CHECK(r.visited == h->n);
+  if (h->n == 0) {
+    return;
+  }
+
+  key_t *arr = malloc(h->n * sizeof(key_t));
+  assert(arr != NULL);
+  rbtree_to_array(h->t, arr, h->n);
+  size_t i = 0;
+  for (size_t k = 0; k < h->range; k++) {
+    for (uint32_t c = 0; c < h->count[k]; c++, i++) {
+      CHECK(arr[i] == (key_t)k);
+    }
+  }
+  CHECK(i == h->n);
+  CHECK(rbtree_min(h->t)->key == arr[0]);
+  CHECK(rbtree_max(h->t)->key == arr[h->n - 1]);
+  free(arr);
+}
+
+static void large_insert(large_model *h, const key_t key) {
+  node_t *p = NULL;
+  CHECK(rbtree_insert_node(h->t, key, &p) == RBTREE_OK);
+  CHECK(p != NULL && p->key == key);
+  h->count[key]++;
+  h->n++;
+}
+
+static void large_erase(large_model *h, const key_t key) {
+  node_t *p = rbtree_find(h->t, key);
+  if (h->count[key] == 0) {
+    CHECK(p == NULL);
+    return;
+  }
+  CHECK(p != NULL && p->key == key);
+  rbtree_erase(h->t, p);
+  h->count[key]--;
+  h->n--;
+}
+
+static void large_find(large_model *h, const key_t key) {
+  node_t *p = rbtree_find(h->t, key);
+  if (h->count[key] != 0) {
+    CHECK(p != NULL && p->key == key);
+  } else {
+    CHECK(p == NULL);
+  }
+}
+
+// Grows the tree to `nodes` nodes, churns it with `nodes` mixed operations
+// and drains it through rbtree_min, validating every `check_every` steps.
+static void run_large(const size_t nodes, uint64_t *seed, const size_t check_every) {
+  large_model m = {0};
+  large_model *h = &m;
+  h->range = 2 * nodes;  // roughly 40% of inserted keys are duplicates
+  h->count = calloc(h->range, sizeof(uint32_t));
+  h->t = new_rbtree();
+  assert(h->count != NULL && h->t != NULL);
+
+  while (h->n < nodes) {
+    large_insert(h, (key_t)(xorshift64(seed) % h->range));
+    if (++h->ops % check_every == 0) {
+      large_check(h);
+    }
+  }
+  large_check(h);
+
+  for (size_t i = 0; i < nodes; i++) {
+    uint64_t r = xorshift64(seed);
+    key_t key = (key_t)((r >> 8) % h->range);
+    switch (r % 3) {
+      case 0:
+        large_insert(h, key);
+        break;
+      case 1:
+        large_erase(h, key);
+        break;
+      default:
+        large_find(h, key);
+        break;
+    }
+    if (++h->ops % check_every == 0) {
+      large_check(h);
+    }
+  }
+  large_check(h);
+
+  size_t k = 0;  // smallest key that may still be present
+  while (h->n > 0) {
+    while (h->count[k] == 0) {
+      k++;
+    }
+    node_t *p = rbtree_min(h->t);
+    CHECK(p->key == (key_t)k);
+    rbtree_erase(h->t, p);
+    h->count[k]--;
+    h->n--;
+    if (++h->ops % check_every == 0) {
+      large_check(h);
+    }
+  }
+  large_check(h);
+
+  delete_rbtree(h->t);
+  free(h->count);
+}
+
+int main(int argc, char *argv[]) {
+  size_t ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 17;
+  size_t check_every = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000;
+  size_t large_nodes = argc > 4 ? strtoull(argv[4], NULL, 10) : 1000000;
+
+  run_random(ops, seed, check_every);
+  if (large_nodes > 0) {
+    // whole-tree checks are O(n), so space them out in proportion to n
+    run_large(large_nodes, &seed, large_nodes / 8 + 1);
+  }
+
+  // replay a few random byte strings through the libFuzzer entry point
+  uint8_t data[3 * 512];
+  for (int round = 0; round < 64; round++) {
+    for (size_t i = 0; i < sizeof(data); i++) {
+      data[i] = (uint8_t)xorshift64(&seed);
+    }
+    LLVMFuzzerTestOneInput(data, sizeof(data));
+  }
+
+  printf("Passed %zu random operations and %zu-node large phase!\n", ops,
+         large_nodes);
+  return 0;
+}
+
+#endif  // RBTREE_LIBFUZZER
@@ -275,6 +275,7 @@ void test_rb_constraints(const key_t arr[], const size_t n) {
 
   test_color_constraint(t);
   test_search_constraint(t);
+  assert(rbtree_validate(t, NULL) == RBTREE_VALID);
 
   delete_rbtree(t);
 }
@@ -367,6 +368,255 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+// counting allocator with an optional limit on live allocations
+typedef struct {
+  size_t live;
+  size_t limit;  // 0 for unlimited
+} counting_ctx;
+
+static void *counting_alloc(void *ctx, size_t size) {
+  counting_ctx *c = (counting_ctx *)ctx;
+  if (c->limit != 0 && c->live >= c->limit) {
+    return NULL;
+  }
+  c->live++;
+  return malloc(size);
+}
+
+static void counting_free(void *ctx, void *ptr, size_t size) {
+  counting_ctx *c = (counting_ctx *)ctx;
+  c->live--;
+  free(ptr);
+}
+
+// custom allocator should be used for every allocation and release
+void test_allocator() {
+  counting_ctx c = {0, 0};
+  const rbtree_allocator a = {counting_alloc, counting_free, &c};
+  rbtree *t = new_rbtree_with(&a, 0);
+  assert(t != NULL);
+  assert(c.live == 2);  // tree and nil
+
+  const key_t arr[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(arr) / sizeof(arr[0]);
+  insert_arr(t, arr, n);
+  assert(c.live == n + 2);
+  assert(t->node_count == n);
+
+  rbtree_erase(t, rbtree_min(t));
+  assert(c.live == n + 1);
+  assert(t->node_count == n - 1);
+
+  delete_rbtree(t);
+  assert(c.live == 0);
+}
+
+// insert should fail cleanly when the node budget is exhausted
+void test_node_budget() {
+  const size_t budget = 8;
+  rbtree *t = new_rbtree_with(NULL, budget);
+  assert(t != NULL);
+
+  node_t *p = NULL;
+  int ret;
+  for (key_t i = 0; i < budget; i++) {
+    ret = rbtree_insert_node(t, i, &p);
+    assert(ret == RBTREE_OK);
+    assert(p != NULL && p->key == i);
+  }
+  p = NULL;
+  ret = rbtree_insert_node(t, 100, &p);
+  assert(ret == RBTREE_EQUOTA);
+  assert(p == NULL);
+  p = rbtree_insert(t, 100);
+  assert(p == NULL);
+  assert(rbtree_find(t, 100) == NULL);
+  assert(t->node_count == budget);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // erasing frees up room for another insert
+  p = rbtree_find(t, 3);
+  assert(p != NULL);
+  rbtree_erase(t, p);
+  ret = rbtree_insert_node(t, 100, NULL);
+  assert(ret == RBTREE_OK);
+  assert(rbtree_find(t, 100) != NULL);
+
+  delete_rbtree(t);
+}
+
+// allocation failures should be reported without corrupting the tree
+void test_out_of_memory() {
+  counting_ctx c = {0, 1};
+  const rbtree_allocator a = {counting_alloc, counting_free, &c};
+  rbtree *t = new_rbtree_with(&a, 0);
+  assert(t == NULL);  // nil allocation fails
+  assert(c.live == 0);
+
+  c.limit = 6;
+  t = new_rbtree_with(&a, 0);
+  assert(t != NULL);
+  int ret;
+  for (key_t i = 0; i < 4; i++) {
+    ret = rbtree_insert_node(t, i, NULL);
+    assert(ret == RBTREE_OK);
+  }
+  ret = rbtree_insert_node(t, 4, NULL);
+  assert(ret == RBTREE_ENOMEM);
+  assert(t->node_count == 4);
+  assert(rbtree_find(t, 4) == NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  delete_rbtree(t);
+  assert(c.live == 0);
+}
+
+// validate should pinpoint the node that breaks each invariant
+void test_validate() {
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+  rbtree_report r;
+  assert(rbtree_validate(t, &r) == RBTREE_VALID);
+  assert(r.visited == 0 && r.black_height == 0);
+
+  const key_t arr[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(arr) / sizeof(arr[0]);
+  insert_arr(t, arr, n);
+  assert(rbtree_validate(t, &r) == RBTREE_VALID);
+  assert(r.violation == RBTREE_VALID && r.node == NULL);
+  assert(r.visited == n);
+  assert(r.black_height > 0);
+
+  unsigned int seed = 17;
+  assert(rbtree_validate_sampled(t, 32, &seed, &r) == RBTREE_VALID);
+
+  // root color
+  t->root->color = RBTREE_RED;
+  assert(rbtree_validate(t, &r) == RBTREE_ERR_ROOT_COLOR);
+  assert(r.node == t->root);
+  t->root->color = RBTREE_BLACK;
+
+  // search order
+  node_t *p = rbtree_max(t);
+  const key_t saved = p->key;
+  p->key = rbtree_min(t)->key - 1;
+  assert(rbtree_validate(t, &r) == RBTREE_ERR_ORDER);
+  assert(r.node == p);
+  seed = 17;
+  assert(rbtree_validate_sampled(t, 1000, &seed, &r) == RBTREE_ERR_ORDER);
+  assert(r.node == p);
+  p->key = saved;
+
+  // parent pointer
+  p = rbtree_min(t);
+  node_t *parent = p->parent;
+  p->parent = t->root == parent ? parent->right : t->root;
+  assert(rbtree_validate(t, &r) == RBTREE_ERR_PARENT);
+  assert(r.node == p);
+  p->parent = parent;
+
+  // red-red and black height
+  p = rbtree_min(t);
+  const color_t color = p->color;
+  p->color = (color == RBTREE_RED) ? RBTREE_BLACK : RBTREE_RED;
+  const rbtree_violation v = rbtree_validate(t, &r);
+  assert(v == RBTREE_ERR_RED_RED || v == RBTREE_ERR_BLACK_HEIGHT);
+  seed = 17;
+  assert(rbtree_validate_sampled(t, 1000, &seed, NULL) != RBTREE_VALID);
+  p->color = color;
+
+  // a path longer than any red-black tree can have: each node links both
+  // children to the next one, so every other invariant still holds
+  node_t chain[130];
+  const size_t len = sizeof(chain) / sizeof(chain[0]);
+  for (size_t i = 0; i < len; i++) {
+    chain[i].color = RBTREE_BLACK;
+    chain[i].key = 0;
+    chain[i].parent = (i == 0) ? t->nil : &chain[i - 1];
+    chain[i].left = chain[i].right = (i + 1 < len) ? &chain[i + 1] : t->nil;
+  }
+  node_t *root = t->root;
+  t->root = &chain[0];
+  assert(rbtree_validate(t, &r) == RBTREE_ERR_HEIGHT);
+  assert(r.node == &chain[128]);
+  seed = 17;
+  assert(rbtree_validate_sampled(t, 1, &seed, &r) == RBTREE_ERR_HEIGHT);
+  assert(r.node == &chain[128]);
+  t->root = root;
+
+  // node count
+  t->node_count++;
+  assert(rbtree_validate(t, &r) == RBTREE_ERR_COUNT);
+  t->node_count--;
+
+  assert(rbtree_validate(t, NULL) == RBTREE_VALID);
+  delete_rbtree(t);
+}
+
+// cached find should agree with the tree and never return erased nodes
+void test_cache() {
+  rbtree *t = new_rbtree();
+  assert(t != NULL);
+  int ret = rbtree_enable_cache(t, 4);
+  assert(ret == RBTREE_OK);
+
+  const key_t arr[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(arr) / sizeof(arr[0]);
+  insert_arr(t, arr, n);
+
+  size_t hits, misses;
+  node_t *p = rbtree_find(t, 34);
+  assert(p != NULL && p->key == 34);
+  assert(rbtree_find(t, 34) == p);
+  rbtree_cache_stats(t, &hits, &misses);
+  assert(hits == 1 && misses == 1);
+
+  // missing keys are not cached
+  assert(rbtree_find(t, 35) == NULL);
+  assert(rbtree_find(t, 35) == NULL);
+  rbtree_cache_stats(t, &hits, &misses);
+  assert(hits == 1 && misses == 3);
+
+  // erase invalidates the cached node, duplicates stay reachable
+  p = rbtree_find(t, 24);
+  assert(p != NULL && p->key == 24);
+  rbtree_erase(t, p);
+  node_t *q = rbtree_find(t, 24);
+  assert(q != NULL && q != p && q->key == 24);
+  rbtree_erase(t, q);
+  assert(rbtree_find(t, 24) == NULL);
+  p = rbtree_insert(t, 24);
+  assert(p != NULL);
+  assert(rbtree_find(t, 24) != NULL);
+
+  // every remaining key through a colliding cache
+  for (size_t i = 0; i < n; i++) {
+    node_t *r = rbtree_find(t, arr[i]);
+    assert(r != NULL && r->key == arr[i]);
+  }
+  assert(rbtree_validate(t, NULL) == RBTREE_VALID);
+
+  rbtree_disable_cache(t);
+  rbtree_cache_stats(t, &hits, &misses);
+  assert(hits == 0 && misses == 0);
+  assert(rbtree_find(t, 34) != NULL);
+
+  // cache is released with the tree
+  ret = rbtree_enable_cache(t, 1000);
+  assert(ret == RBTREE_OK);
+  assert(t->cache != NULL && t->cache->size == 1024);
+  delete_rbtree(t);
+
+  t = new_rbtree();
+  assert(t != NULL);
+  ret = rbtree_enable_cache(t, 8);
+  assert(ret == RBTREE_OK);
+  test_find_erase(t, arr, n);
+  delete_rbtree(t);
+}
+
 int main(void) {
   test_init();
   test_insert_single(1024);
@@ -379,5 +629,10 @@ int main(void) {
   test_duplicate_values();
   test_multi_instance();
   test_find_erase_rand(10000, 17);
+  test_allocator();
+  test_node_budget();
+  test_out_of_memory();
+  test_validate();
+  test_cache();
   printf("Passed all tests!\n");
 }